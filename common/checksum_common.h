@@ -8,6 +8,7 @@
 #define DPU_BUFFER dpu_mram_buffer
 #define DPU_CACHES dpu_wram_caches
 #define DPU_RESULTS dpu_wram_results
+#define DPU_NR_ELEMENTS dpu_wram_nr_elements
 
 /* Size of the buffer on which the checksum will be performed */
 #define BUFFER_SIZE (60 << 20) / 4
@@ -41,6 +41,9 @@
 __dma_aligned uint32_t DPU_CACHES[NR_TASKLETS][ELEMS_IN_CACHE];
 __host dpu_results_t DPU_RESULTS;
 
+/* if set by the host, overrides the length stored in DPU_BUFFER[0] */
+__host uint32_t DPU_NR_ELEMENTS;
+
 __mram_noinit uint32_t DPU_BUFFER[BUFFER_SIZE];
 
 /**
@@ -59,7 +62,7 @@ int main() {
 
     uint32_t partial_checksum = checksum_init();
 
-    const uint32_t n = DPU_BUFFER[0];
+    const uint32_t n = DPU_NR_ELEMENTS ? DPU_NR_ELEMENTS : DPU_BUFFER[0];
 
     for (uint32_t buffer_idx = tasklet_id * ELEMS_IN_CACHE; buffer_idx < n; buffer_idx += (NR_TASKLETS * ELEMS_IN_CACHE)) {
 
@@ -12,7 +12,12 @@
 
 #include <cassert>
 
+#include "occupancy.hpp"
+#include "perf_counters.hpp"
+#include "reduce.hpp"
+#include "startup.hpp"
 #include "timer.hpp"
+#include "verify.hpp"
 
 extern "C" {
 #include <dpu.h>
@@ -55,7 +60,7 @@ std::vector<T *> allocate_buffers(size_t total_elements) {
   return buffer;
 }
 
-enum class Mode { Scatter, Scatter2Per8, Scatter4Per8, Broadcast, ControllerBroadcast, Gather };
+enum class Mode { Scatter, MaskedScatter, Broadcast, ControllerBroadcast, Gather, MaskedGather, GatherReduce, GatherThenReduce };
 const char* mode_to_string(Mode mode) {
     if (mode == Mode::Broadcast) {
         return "Broadcast";
@@ -69,27 +74,66 @@ const char* mode_to_string(Mode mode) {
         return "Gather";
     }
 
-    if (mode == Mode::Scatter) {
-        return "Scatter";
+    if (mode == Mode::MaskedGather) {
+        return "MaskedGather";
+    }
+
+    if (mode == Mode::GatherReduce) {
+        return "GatherReduce";
     }
 
-    if (mode == Mode::Scatter2Per8) {
-        return "Scatter2Per8";
+    if (mode == Mode::GatherThenReduce) {
+        return "GatherThenReduce";
     }
 
-    if (mode == Mode::Scatter4Per8) {
-        return "Scatter4Per8";
+    if (mode == Mode::Scatter) {
+        return "Scatter";
+    }
+
+    if (mode == Mode::MaskedScatter) {
+        return "MaskedScatter";
     }
 
     abort();
 }
 
+bool is_masked(Mode mode) {
+    return mode == Mode::MaskedScatter || mode == Mode::MaskedGather;
+}
+
+bool is_reduce(Mode mode) {
+    return mode == Mode::GatherReduce || mode == Mode::GatherThenReduce;
+}
+
+bool is_gather(Mode mode) {
+    return mode == Mode::Gather || mode == Mode::MaskedGather || is_reduce(mode);
+}
+
+// Host range gathered from one rank, handed to the reduction engine
+struct RankReduction {
+  ReductionEngine *engine;
+  int numa_node;
+  const T *first;
+  size_t nr_dpus;
+};
+
+dpu_error_t submit_rank_reduction(dpu_set_t, uint32_t, void *arg) {
+  const auto *r = static_cast<const RankReduction *>(arg);
+  r->engine->submit(r->numa_node, r->first, r->nr_dpus);
+  return DPU_OK;
+}
+
 
 void benchmark(dpu_set_t dpu_set,
                bool aligned,
                std::vector<T *> buffers,
                size_t nr_elem_per_dpu, Mode mode,
-               const char *profile) {
+               const char *profile,
+               const OccupancyMask *mask = nullptr,
+               ReductionEngine *engine = nullptr,
+               ReduceOp reduce_op = ReduceOp::Sum,
+               Verifier *verifier = nullptr,
+               PerfCounters *counters = nullptr) {
 
   const uint32_t nr_dpus = [&] {
     uint32_t tmp;
@@ -102,7 +146,27 @@ void benchmark(dpu_set_t dpu_set,
   int numa_rank_offset = rand();
   (void)numa_rank_offset;
 
-  Timer timer("Transfer", nr_dpus * nr_elem_per_dpu * sizeof(T));
+  // DPU -> host buffer it was transferred from/to, only kept for verification
+  std::vector<const T *> endpoints(verifier ? nr_dpus : 0, nullptr);
+  if (verifier && is_gather(mode)) {
+    verifier->seed_gather_pattern(dpu_set, nr_elem_per_dpu);
+  }
+
+  const size_t active_dpus = mask ? mask->active_dpus() : nr_dpus;
+  const size_t effective_bytes = active_dpus * nr_elem_per_dpu * sizeof(T);
+
+  // reserved up front, the callbacks keep pointers into the vector
+  std::vector<RankReduction> rank_reductions;
+  if (is_reduce(mode)) {
+    rank_reductions.reserve(nr_ranks);
+    engine->start(reduce_op, nr_elem_per_dpu);
+  }
+
+  if (counters) {
+    counters->start();
+  }
+
+  Timer timer("Transfer", effective_bytes);
 
   struct dpu_set_t rank, dpu;
   uint32_t rank_id, dpu_id;
@@ -114,16 +178,20 @@ void benchmark(dpu_set_t dpu_set,
     const auto rank_numa_node = (numa_rank_offset + rank_id) % nr_numa_nodes;
 #endif
 
+    const T *rank_first = buffers[rank_numa_node];
+    size_t nr_rank_xfers = 0;
+
     DPU_FOREACH(rank, dpu, dpu_id) {
       T *first;
       switch (mode) {
       case Mode::Scatter:
-      case Mode::Scatter2Per8:
-      case Mode::Scatter4Per8:
+      case Mode::MaskedScatter:
       case Mode::Gather:
+      case Mode::MaskedGather:
+      case Mode::GatherReduce:
+      case Mode::GatherThenReduce:
       {
-        if (mode == Mode::Scatter2Per8 &&  (rank_id + dpu_id) % 2 != 0) continue;
-        if (mode == Mode::Scatter4Per8 &&  (rank_id + dpu_id) % 4 != 0) continue;
+        if (mask && !mask->is_active(rank_id, dpu_id)) continue;
         first = buffers[rank_numa_node];
         buffers[rank_numa_node] += nr_elem_per_dpu;
         break;
@@ -140,20 +208,72 @@ void benchmark(dpu_set_t dpu_set,
       }
       }
 
+      if (verifier) {
+        endpoints[rank_id * nr_dpus_per_rank + dpu_id] = first;
+      }
+
       DPU_ASSERT(dpu_prepare_xfer(dpu, first));
+      nr_rank_xfers++;
+    }
+
+    if (nr_rank_xfers == 0) {
+      continue; // the mask leaves no DPU of this rank active
     }
 
     const auto bytes_per_dpu = nr_elem_per_dpu * sizeof(T);
     DPU_ASSERT(dpu_push_xfer(
-        rank, mode == Mode::Gather ? DPU_XFER_FROM_DPU : DPU_XFER_TO_DPU,
+        rank, is_gather(mode) ? DPU_XFER_FROM_DPU : DPU_XFER_TO_DPU,
         "dpu_mram_buffer", 0, bytes_per_dpu, DPU_XFER_ASYNC));
+
+    if (is_reduce(mode)) {
+      rank_reductions.push_back({engine, static_cast<int>(rank_numa_node), rank_first, nr_rank_xfers});
+      if (mode == Mode::GatherReduce) {
+        // reduce this rank as soon as its gather completed
+        DPU_ASSERT(dpu_callback(rank, submit_rank_reduction, &rank_reductions.back(),
+                                DPU_CALLBACK_ASYNC));
+      }
+    }
   }
 
   DPU_ASSERT(dpu_sync(dpu_set));
 
+  double reduce_tail_seconds = 0;
+  uint64_t reduce_digest = 0;
+  if (is_reduce(mode)) {
+    const auto gathered = timer.seconds_since_start();
+    if (mode == Mode::GatherThenReduce) {
+      for (const auto &r : rank_reductions) {
+        engine->submit(r.numa_node, r.first, r.nr_dpus);
+      }
+    }
+    reduce_digest = engine->finish().digest(reduce_op);
+    reduce_tail_seconds = timer.seconds_since_start() - gathered;
+  }
+
   const auto elapsed = timer.seconds_since_start();
-  auto gbs =
-      ((double)nr_dpus * nr_elem_per_dpu * sizeof(T)) / (1 << 30) / elapsed;
+  if (counters) {
+    counters->stop();
+  }
+  auto gbs = ((double)effective_bytes) / (1 << 30) / elapsed;
+
+  VerifyResult verified;
+  if (verifier) {
+    verified = is_gather(mode)
+                   ? verifier->check_gather(endpoints, nr_elem_per_dpu)
+                   : verifier->check_transfer(dpu_set, endpoints, nr_elem_per_dpu);
+  }
+
+  if (verifier && is_reduce(mode)) {
+    std::vector<std::pair<const T *, size_t>> ranges;
+    for (const auto &r : rank_reductions) {
+      ranges.emplace_back(r.first, r.nr_dpus);
+    }
+
+    const auto reduced = verifier->check_reduce(reduce_op, engine->topk(), ranges,
+                                                nr_elem_per_dpu, reduce_digest);
+    verified.mismatches += reduced.mismatches;
+    verified.seconds += reduced.seconds;
+  }
 
   std::cerr << "{" //
                "\"mode\": \""
@@ -178,25 +298,70 @@ void benchmark(dpu_set_t dpu_set,
             << aligned <<
                ", " //
                "\"profile\": \""
-            << profile << "\"}\n";
+            << profile << "\"";
+
+  if (mask) {
+    std::cerr << ", " //
+                 "\"mask\": \""
+              << mask->name()
+              << "\", " //
+                 "\"active_dpus\": "
+              << active_dpus
+              << ", " //
+                 "\"touched_chips\": "
+              << mask->touched_chips()
+              << ", " //
+                 "\"touched_ranks\": "
+              << mask->touched_ranks()
+              << ", " //
+                 "\"effective_bytes\": "
+              << effective_bytes;
+  }
+
+  if (is_reduce(mode)) {
+    std::cerr << ", " //
+                 "\"reduce\": \""
+              << reduce_op_to_string(reduce_op)
+              << "\", " //
+                 "\"reduce_tail_seconds\": "
+              << reduce_tail_seconds
+              << ", " //
+                 "\"reduce_digest\": "
+              << reduce_digest;
+  }
+
+  if (counters) {
+    std::cerr << ", ";
+    counters->print_json_fields(std::cerr);
+  }
+
+  if (verifier) {
+    std::cerr << ", " //
+                 "\"verified_dpus\": "
+              << verified.checked_dpus
+              << ", " //
+                 "\"mismatches\": "
+              << verified.mismatches
+              << ", " //
+                 "\"verify_seconds\": "
+              << verified.seconds;
+  }
+
+  std::cerr << "}\n";
 
   timer.hide();
 }
 
-dpu_set_t alloc_dpus(const char *profile) {
-  struct dpu_set_t set;
+dpu_set_t alloc_dpus(DpuSetCache &cache, const char *profile) {
   uint32_t nr_dpus;
   std::cout << "Profile: " << profile << "\n";
 
-  DPU_ASSERT(dpu_alloc_ranks(nr_ranks, profile, &set));
+  auto set = cache.acquire(profile);
+  const auto &startup = cache.last_startup();
+  std::cout << "Startup: alloc=" << startup.alloc_seconds
+            << "s load=" << startup.load_seconds << "s"
+            << (startup.reused ? " (reused)" : "") << "\n";
 
-  if (set.list.nr_ranks != nr_ranks) {
-    std::cout << "Expected " << nr_ranks << " ranks, got " << set.list.nr_ranks
-              << "\n";
-    abort();
-  }
-
-  DPU_ASSERT(dpu_load(set, binary, NULL));
   DPU_ASSERT(dpu_get_nr_dpus(set, &nr_dpus));
   std::cout << "Got " << nr_dpus << " DPUs\n";
 
@@ -222,11 +387,13 @@ std::vector<Mode> fetch_benchmark_modes(const char* regex) {
     };
 
     add_if_match(Mode::Scatter);
-    add_if_match(Mode::Scatter2Per8);
-    add_if_match(Mode::Scatter4Per8);
+    add_if_match(Mode::MaskedScatter);
     add_if_match(Mode::Broadcast);
     add_if_match(Mode::ControllerBroadcast);
     add_if_match(Mode::Gather);
+    add_if_match(Mode::MaskedGather);
+    add_if_match(Mode::GatherReduce);
+    add_if_match(Mode::GatherThenReduce);
 
     if (result.empty()) {
         std::cerr << "Pattern does not match any benchmarks\n";
@@ -237,13 +404,108 @@ std::vector<Mode> fetch_benchmark_modes(const char* regex) {
 }
 
 
+void print_usage(const char *prog) {
+  std::cout << "Usage: " << prog << " [-c] [-k] [-p] [-m MASK]... [-r OP]... [-t THREADS] [-v DPU_STRIDE] [-s SIZE_STRIDE] [MODE_REGEX]\n"
+               "  -c              attach hardware performance counters of the timed region\n"
+               "  -k              keep the loaded DPU set across repetitions of a profile\n"
+               "                  (repetitions then run grouped by profile)\n"
+               "  -p              load the DPU binary onto all ranks in parallel\n"
+               "  -m MASK         occupancy mask for the Masked* modes, may be repeated\n"
+               "                  (default: every:2 and every:4; see occupancy.hpp for the syntax)\n"
+               "  -r OP           reduction for the *Reduce modes: Sum, MinMax, Histogram or TopK,\n"
+               "                  may be repeated (default: Sum)\n"
+               "  -t THREADS      reduction threads per NUMA node (default: 4)\n"
+               "  -v DPU_STRIDE   verify transfers on every DPU_STRIDE-th DPU (default: off)\n"
+               "  -s SIZE_STRIDE  only verify every SIZE_STRIDE-th transfer size (default: 1)\n";
+}
+
 int main(int argc, char* argv[]) {
   if (numa_available() == -1) {
     std::cerr << "No NUMA support\n";
     abort();
   }
 
-  const auto modes = fetch_benchmark_modes(argc > 1 ? argv[1] : ".*");
+  size_t verify_dpu_stride = 0;
+  size_t verify_size_stride = 1;
+  std::vector<std::string> mask_specs;
+  bool keep_dpus = false;
+  bool parallel_load = false;
+  bool count_events = false;
+  std::vector<ReduceOp> reduce_ops;
+  size_t reduce_threads = 4;
+  for (int opt; (opt = getopt(argc, argv, "ckpm:r:t:v:s:h")) != -1;) {
+    switch (opt) {
+    case 'r': {
+      bool found = false;
+      for (auto op : {ReduceOp::Sum, ReduceOp::MinMax, ReduceOp::Histogram, ReduceOp::TopK}) {
+        if (std::string(optarg) == reduce_op_to_string(op)) {
+          reduce_ops.push_back(op);
+          found = true;
+        }
+      }
+      if (!found) {
+        std::cerr << "Unknown reduction " << optarg << "\n";
+        abort();
+      }
+      break;
+    }
+    case 't':
+      reduce_threads = std::stoul(optarg);
+      break;
+    case 'c':
+      count_events = true;
+      break;
+    case 'k':
+      keep_dpus = true;
+      break;
+    case 'p':
+      parallel_load = true;
+      break;
+    case 'm':
+      mask_specs.emplace_back(optarg);
+      break;
+    case 'v':
+      verify_dpu_stride = std::stoul(optarg);
+      break;
+    case 's':
+      verify_size_stride = std::stoul(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  const auto modes = fetch_benchmark_modes(optind < argc ? argv[optind] : ".*");
+  Verifier verifier(verify_dpu_stride, verify_size_stride);
+
+  if (mask_specs.empty()) {
+    mask_specs = {"every:2", "every:4"};
+  }
+  if (reduce_ops.empty()) {
+    reduce_ops = {ReduceOp::Sum};
+  }
+
+  // opened before any worker thread is spawned, so that process-scope counters
+  // are inherited by all of them
+  std::unique_ptr<PerfCounters> counters;
+  if (count_events) {
+    counters = std::make_unique<PerfCounters>();
+  }
+
+  std::unique_ptr<ReductionEngine> engine;
+  if (std::any_of(modes.begin(), modes.end(), is_reduce)) {
+    engine = std::make_unique<ReductionEngine>(reduce_threads);
+  }
+
+  std::vector<OccupancyMask> masks;
+  for (const auto &spec : mask_specs) {
+    masks.emplace_back(spec, nr_ranks, nr_dpus_per_rank);
+  }
+  if (verifier.enabled()) {
+    std::cout << "Verifying every " << verify_dpu_stride << "-th DPU at every "
+              << verify_size_stride << "-th size\n";
+  }
 
 #ifdef USE_DPU_NUMA
   std::cout << "Using NUMA infos of each DPU\n";
@@ -256,29 +518,55 @@ int main(int argc, char* argv[]) {
       unaligned_buffers.push_back(p + 1);
   }
 
+  std::vector<std::string> profiles;
   for (int i = 0; i < 3; ++i) {
       for (int nrThreadPerPool = 1; nrThreadPerPool <= 8;
            nrThreadPerPool *= 2) {
+        profiles.push_back("nrThreadPerPool=" + std::to_string(nrThreadPerPool));
+      }
+  }
+
+  if (keep_dpus) {
+      // consecutive runs of the same profile can share one loaded DPU set
+      std::stable_sort(profiles.begin(), profiles.end());
+  }
 
-        std::string profile =
-            "nrThreadPerPool=" + std::to_string(nrThreadPerPool);
+  DpuSetCache dpu_sets(binary, nr_ranks, parallel_load);
 
-        auto set = alloc_dpus(profile.c_str());
+  for (const auto &profile : profiles) {
+    auto set = alloc_dpus(dpu_sets, profile.c_str());
 
-        for (size_t n = 16; true; n *= 2) {
-          n = std::min(n, max_elems_per_dpu);
-          for (auto mode : modes) {
-              for(int aligned = 0; aligned <= 1; ++aligned) {
-                  benchmark(set, aligned, aligned ? buffers : unaligned_buffers, n, mode, profile.c_str());
+    for (size_t n = 16, size_step = 0; true; n *= 2, ++size_step) {
+      n = std::min(n, max_elems_per_dpu);
+      auto *verify = verifier.covers_size_step(size_step) ? &verifier : nullptr;
+      for (auto mode : modes) {
+          std::vector<const OccupancyMask *> mode_masks = {nullptr};
+          if (is_masked(mode)) {
+              mode_masks.clear();
+              for (const auto &mask : masks) {
+                  mode_masks.push_back(&mask);
               }
           }
-          if (n == max_elems_per_dpu) {
-            break;
-          }
-        }
 
-        DPU_ASSERT(dpu_free(set));
+          const auto mode_reduce_ops = is_reduce(mode) ? reduce_ops : std::vector<ReduceOp>{ReduceOp::Sum};
+
+          for (const auto *mask : mode_masks) {
+              for (auto reduce_op : mode_reduce_ops) {
+                  for(int aligned = 0; aligned <= 1; ++aligned) {
+                      benchmark(set, aligned, aligned ? buffers : unaligned_buffers, n, mode, profile.c_str(),
+                                mask, engine.get(), reduce_op, verify, counters.get());
+                  }
+              }
+          }
       }
+      if (n == max_elems_per_dpu) {
+        break;
+      }
+    }
+
+    if (!keep_dpus) {
+      dpu_sets.release();
+    }
   }
 
   std::cerr << "\n";
@@ -0,0 +1,238 @@
+// Latency of the control plane: tiny WRAM/MRAM host-symbol transfers to a
+// single DPU, one rank and all ranks, plus the launch-poll-fetch-results
+// cycle of an iterative DPU algorithm, each broken down into its phases.
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "startup.hpp"
+#include "timer.hpp"
+
+extern "C" {
+#include <dpu.h>
+#include "../common/checksum_common.h"
+}
+
+const size_t nr_ranks = 32;
+const char *binary = "./checksum_dpu";
+const size_t nr_samples = 1000;
+const size_t nr_cycles = 200;
+
+// elements the checksum kernel processes per cycle; small enough that compute
+// does not hide the control-plane overhead
+const uint32_t cycle_elements = 16;
+
+enum class Scope { Dpu, Rank, All };
+const char *scope_to_string(Scope scope) {
+  if (scope == Scope::Dpu) {
+    return "Dpu";
+  }
+
+  if (scope == Scope::Rank) {
+    return "Rank";
+  }
+
+  if (scope == Scope::All) {
+    return "All";
+  }
+
+  abort();
+}
+
+struct Target {
+  Scope scope;
+  dpu_set_t set;
+  uint32_t nr_dpus;
+};
+
+void print_record(const char *op, const Target &target, size_t bytes_per_dpu,
+                  const LatencySamples &samples, const char *profile) {
+  std::cerr << "{" //
+               "\"mode\": \""
+            << op
+            << "\", " //
+               "\"scope\": \""
+            << scope_to_string(target.scope)
+            << "\", " //
+               "\"dpus\": "
+            << target.nr_dpus
+            << ", " //
+               "\"bytes_per_dpu\": "
+            << bytes_per_dpu << ", ";
+  samples.print_json_fields(std::cerr);
+  std::cerr << ", " //
+               "\"profile\": \""
+            << profile << "\"}\n";
+}
+
+LatencySamples sample(const std::function<void()> &op) {
+  LatencySamples samples;
+  for (size_t i = 0; i < nr_samples; ++i) {
+    Timer timer("Op");
+    timer.hide();
+    op();
+    samples.add(timer.seconds_since_start());
+  }
+  return samples;
+}
+
+// Writes `bytes` from `data` to the symbol of every DPU in the target. A single
+// DPU uses dpu_copy_to, larger sets prepare one buffer per DPU and push them.
+void write_symbol(const Target &target, const char *symbol, void *data,
+                  size_t bytes) {
+  if (target.scope == Scope::Dpu) {
+    DPU_ASSERT(dpu_copy_to(target.set, symbol, 0, data, bytes));
+    return;
+  }
+
+  dpu_set_t dpu;
+  DPU_FOREACH(target.set, dpu) { DPU_ASSERT(dpu_prepare_xfer(dpu, data)); }
+  DPU_ASSERT(dpu_push_xfer(target.set, DPU_XFER_TO_DPU, symbol, 0, bytes,
+                           DPU_XFER_DEFAULT));
+}
+
+void read_symbol(const Target &target, const char *symbol, uint8_t *data,
+                 size_t bytes) {
+  if (target.scope == Scope::Dpu) {
+    DPU_ASSERT(dpu_copy_from(target.set, symbol, 0, data, bytes));
+    return;
+  }
+
+  dpu_set_t dpu;
+  uint32_t dpu_idx;
+  DPU_FOREACH(target.set, dpu, dpu_idx) {
+    DPU_ASSERT(dpu_prepare_xfer(dpu, data + dpu_idx * bytes));
+  }
+  DPU_ASSERT(dpu_push_xfer(target.set, DPU_XFER_FROM_DPU, symbol, 0, bytes,
+                           DPU_XFER_DEFAULT));
+}
+
+void benchmark_symbols(const Target &target, const char *profile) {
+  // MRAM transfers must be multiples of 8 bytes
+  const size_t mram_bytes = 8;
+  std::vector<uint8_t> host(target.nr_dpus * sizeof(dpu_results_t));
+
+  print_record("WramWrite", target, sizeof(uint32_t),
+               sample([&] { write_symbol(target, XSTR(DPU_NR_ELEMENTS), host.data(), sizeof(uint32_t)); }),
+               profile);
+
+  print_record("WramRead", target, sizeof(dpu_results_t),
+               sample([&] { read_symbol(target, XSTR(DPU_RESULTS), host.data(), sizeof(dpu_results_t)); }),
+               profile);
+
+  print_record("MramWrite", target, mram_bytes,
+               sample([&] { write_symbol(target, XSTR(DPU_BUFFER), host.data(), mram_bytes); }),
+               profile);
+
+  print_record("MramRead", target, mram_bytes,
+               sample([&] { read_symbol(target, XSTR(DPU_BUFFER), host.data(), mram_bytes); }),
+               profile);
+}
+
+// One iteration of an iterative DPU algorithm: set the parameters, launch,
+// poll until all DPUs are done and fetch the per-DPU results.
+void benchmark_cycle(const Target &target, const char *profile) {
+  std::vector<dpu_results_t> results(target.nr_dpus);
+  uint32_t nr_elements = cycle_elements;
+
+  LatencySamples write, launch, poll, fetch, total;
+  size_t nr_polls = 0;
+
+  for (size_t i = 0; i < nr_cycles; ++i) {
+    Timer timer("Cycle");
+    timer.hide();
+    double last = 0;
+    auto lap = [&](LatencySamples &phase) {
+      const auto now = timer.seconds_since_start();
+      phase.add(now - last);
+      last = now;
+    };
+
+    DPU_ASSERT(dpu_broadcast_to(target.set, XSTR(DPU_NR_ELEMENTS), 0, &nr_elements,
+                                sizeof(nr_elements), DPU_XFER_DEFAULT));
+    lap(write);
+
+    DPU_ASSERT(dpu_launch(target.set, DPU_ASYNCHRONOUS));
+    lap(launch);
+
+    for (bool done = false, fault = false; !done;) {
+      DPU_ASSERT(dpu_status(target.set, &done, &fault));
+      if (fault) {
+        std::cerr << "DPU fault during control-plane cycle\n";
+        abort();
+      }
+      nr_polls++;
+    }
+    lap(poll);
+
+    read_symbol(target, XSTR(DPU_RESULTS), reinterpret_cast<uint8_t *>(results.data()),
+                sizeof(dpu_results_t));
+    lap(fetch);
+
+    total.add(last);
+  }
+
+  std::cerr << "{" //
+               "\"mode\": \"Cycle\", " //
+               "\"scope\": \""
+            << scope_to_string(target.scope)
+            << "\", " //
+               "\"dpus\": "
+            << target.nr_dpus
+            << ", " //
+               "\"elements_per_dpu\": "
+            << cycle_elements
+            << ", " //
+               "\"polls_per_cycle\": "
+            << static_cast<double>(nr_polls) / nr_cycles << ", ";
+  total.print_json_fields(std::cerr);
+  std::cerr << ", ";
+  write.print_json_fields(std::cerr, "write_");
+  std::cerr << ", ";
+  launch.print_json_fields(std::cerr, "launch_");
+  std::cerr << ", ";
+  poll.print_json_fields(std::cerr, "poll_");
+  std::cerr << ", ";
+  fetch.print_json_fields(std::cerr, "fetch_");
+  std::cerr << ", " //
+               "\"profile\": \""
+            << profile << "\"}\n";
+}
+
+int main() {
+  for (int nrThreadPerPool = 1; nrThreadPerPool <= 8; nrThreadPerPool *= 2) {
+    const auto profile = "nrThreadPerPool=" + std::to_string(nrThreadPerPool);
+    std::cout << "Profile: " << profile << "\n";
+
+    StartupTimes times;
+    auto set = alloc_and_load(nr_ranks, profile.c_str(), binary, true, times);
+
+    std::vector<Target> targets;
+    {
+      dpu_set_t rank, dpu;
+      DPU_RANK_FOREACH(set, rank) { break; }
+      DPU_FOREACH(rank, dpu) { break; }
+
+      uint32_t nr_rank_dpus, nr_dpus;
+      DPU_ASSERT(dpu_get_nr_dpus(rank, &nr_rank_dpus));
+      DPU_ASSERT(dpu_get_nr_dpus(set, &nr_dpus));
+
+      targets.push_back({Scope::Dpu, dpu, 1});
+      targets.push_back({Scope::Rank, rank, nr_rank_dpus});
+      targets.push_back({Scope::All, set, nr_dpus});
+    }
+
+    for (const auto &target : targets) {
+      benchmark_symbols(target, profile.c_str());
+      benchmark_cycle(target, profile.c_str());
+    }
+
+    DPU_ASSERT(dpu_free(set));
+  }
+
+  std::cerr << "\n";
+}
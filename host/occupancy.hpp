@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Selects which DPUs take part in a masked transfer. Masks are built from a
+// textual spec so that sparsity patterns can be chosen on the command line:
+//
+//   every:K[+O]        DPUs with (rank_id + dpu_id) % K == O (default O = 0)
+//   rank:HEX[,HEX...]  64-bit DPU bitmap per rank, the list repeats over ranks
+//   chips:N            the first N chips of each rank are fully occupied
+//   chipmask:HEX       8-bit bitmap of fully occupied chips per rank
+//   ranks:N            the first N ranks are fully occupied
+//   density:P[@SEED]   each DPU is occupied independently with probability P
+//
+// A chip holds 8 consecutive DPUs of a rank.
+class OccupancyMask {
+public:
+  static constexpr size_t dpus_per_chip = 8;
+
+  OccupancyMask(std::string spec, size_t nr_ranks, size_t nr_dpus_per_rank)
+      : spec(std::move(spec)), nr_dpus_per_rank(nr_dpus_per_rank),
+        active(nr_ranks * nr_dpus_per_rank, false) {
+    const auto colon = this->spec.find(':');
+    if (colon == std::string::npos) {
+      fail("expected KIND:ARGS");
+    }
+
+    const auto kind = this->spec.substr(0, colon);
+    const auto nr_chips_per_rank = nr_dpus_per_rank / dpus_per_chip;
+    const auto args = this->spec.substr(colon + 1);
+
+    if (kind == "every") {
+      const auto plus = args.find('+');
+      const auto k = parse_number(args.substr(0, plus));
+      const auto offset = plus == std::string::npos ? 0 : parse_number(args.substr(plus + 1));
+      if (k == 0) {
+        fail("stride must be positive");
+      }
+      assign([&](size_t rank_id, size_t dpu_id) { return (rank_id + dpu_id) % k == offset; });
+
+    } else if (kind == "rank") {
+      std::vector<uint64_t> bitmaps;
+      for (size_t begin = 0; begin <= args.size();) {
+        auto end = args.find(',', begin);
+        if (end == std::string::npos) {
+          end = args.size();
+        }
+        bitmaps.push_back(parse_number(args.substr(begin, end - begin), 16));
+        begin = end + 1;
+      }
+      assign([&](size_t rank_id, size_t dpu_id) {
+        return (bitmaps[rank_id % bitmaps.size()] >> dpu_id) & 1;
+      });
+
+    } else if (kind == "chips") {
+      const auto nr_chips = parse_number(args);
+      if (nr_chips > nr_chips_per_rank) {
+        fail("a rank has only " + std::to_string(nr_chips_per_rank) + " chips");
+      }
+      assign([&](size_t, size_t dpu_id) { return dpu_id / dpus_per_chip < nr_chips; });
+
+    } else if (kind == "chipmask") {
+      const auto bitmap = parse_number(args, 16);
+      if (bitmap >> nr_chips_per_rank) {
+        fail("bitmap is wider than the " + std::to_string(nr_chips_per_rank) + " chips of a rank");
+      }
+      assign([&](size_t, size_t dpu_id) { return (bitmap >> (dpu_id / dpus_per_chip)) & 1; });
+
+    } else if (kind == "ranks") {
+      const auto nr_active_ranks = parse_number(args);
+      if (nr_active_ranks > nr_ranks) {
+        fail("only " + std::to_string(nr_ranks) + " ranks are allocated");
+      }
+      assign([&](size_t rank_id, size_t) { return rank_id < nr_active_ranks; });
+
+    } else if (kind == "density") {
+      const auto at = args.find('@');
+      double density = 0;
+      try {
+        density = std::stod(args.substr(0, at));
+      } catch (...) {
+        fail("cannot parse density");
+      }
+      if (!(density >= 0 && density <= 1)) {
+        fail("density must be within [0, 1]");
+      }
+      const auto seed = at == std::string::npos ? 1 : parse_number(args.substr(at + 1));
+
+      std::mt19937_64 gen(seed);
+      std::bernoulli_distribution coin(density);
+      assign([&](size_t, size_t) { return coin(gen); });
+
+    } else {
+      fail("unknown kind");
+    }
+
+    if (active_dpus() == 0) {
+      fail("selects no DPU");
+    }
+  }
+
+  const std::string &name() const { return spec; }
+
+  bool is_active(size_t rank_id, size_t dpu_id) const {
+    return active[rank_id * nr_dpus_per_rank + dpu_id];
+  }
+
+  size_t active_dpus() const {
+    size_t result = 0;
+    for (bool x : active) {
+      result += x;
+    }
+    return result;
+  }
+
+  size_t touched_chips() const { return count_touched_groups(dpus_per_chip); }
+
+  size_t touched_ranks() const { return count_touched_groups(nr_dpus_per_rank); }
+
+private:
+  std::string spec;
+  size_t nr_dpus_per_rank;
+  std::vector<bool> active;
+
+  template <typename F> void assign(F &&pred) {
+    for (size_t i = 0; i < active.size(); ++i) {
+      active[i] = pred(i / nr_dpus_per_rank, i % nr_dpus_per_rank);
+    }
+  }
+
+  size_t count_touched_groups(size_t group_size) const {
+    size_t result = 0;
+    for (size_t begin = 0; begin < active.size(); begin += group_size) {
+      for (size_t i = begin; i < begin + group_size && i < active.size(); ++i) {
+        if (active[i]) {
+          result++;
+          break;
+        }
+      }
+    }
+    return result;
+  }
+
+  uint64_t parse_number(const std::string &str, int base = 10) const {
+    try {
+      size_t pos;
+      const auto result = std::stoull(str, &pos, base);
+      if (pos == str.size()) {
+        return result;
+      }
+    } catch (...) {
+    }
+    fail("cannot parse '" + str + "'");
+  }
+
+  [[noreturn]] void fail(const std::string &msg) const {
+    std::cerr << "Invalid occupancy mask '" << spec << "': " << msg << "\n";
+    abort();
+  }
+};
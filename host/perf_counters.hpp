@@ -0,0 +1,302 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware performance counters read via perf_event_open around a region of
+// code. If the kernel allows it (perf_event_paranoid <= 0 or CAP_PERFMON),
+// counters are opened system-wide on every CPU, which also covers libdpu's
+// worker threads and enables the uncore memory-controller (IMC) counters.
+// Otherwise they fall back to counting all threads of this process in user
+// space, and the IMC counters are unavailable. Counters the CPU or kernel do
+// not provide are silently left out of the report.
+//
+// # Example
+// PerfCounters counters;
+// counters.start();
+// ... hot path ...
+// counters.stop();
+// counters.print_json_fields(std::cerr);
+class PerfCounters {
+public:
+  PerfCounters() {
+    system_wide = probe_system_wide();
+    if (!system_wide) {
+      raise_fd_limit();
+    }
+
+    add_core("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    add_core("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    add_core("llc_load_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL));
+    add_core("dtlb_load_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB));
+    add_core("dtlb_store_misses", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_WRITE));
+    // loads served by the memory of another NUMA node (perf's node-load-misses)
+    add_core("remote_node_loads", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_NODE));
+
+    if (system_wide) {
+      add_uncore("imc_read_bytes", "cas_count_read");
+      add_uncore("imc_write_bytes", "cas_count_write");
+    }
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  ~PerfCounters() {
+    for (auto &counter : counters) {
+      for (int fd : counter.fds) {
+        close(fd);
+      }
+    }
+  }
+
+  // Counts are reported relative to the values read here. PERF_EVENT_IOC_RESET
+  // would not do: it leaves the counts that exited inherited threads already
+  // folded into their parent's event.
+  void start() {
+    for (auto &counter : counters) {
+      for (size_t i = 0; i < counter.fds.size(); ++i) {
+        counter.baselines[i] = read_fd(counter.fds[i]);
+      }
+    }
+    for_each_fd(PERF_EVENT_IOC_ENABLE);
+  }
+
+  void stop() { for_each_fd(PERF_EVENT_IOC_DISABLE); }
+
+  void print_json_fields(std::ostream &os) const {
+    os << "\"perf_scope\": \"" << (system_wide ? "system" : "process") << "\"";
+    for (const auto &counter : counters) {
+      os << ", \"perf_" << counter.name << "\": " << static_cast<uint64_t>(read(counter));
+    }
+  }
+
+private:
+  struct ReadFormat {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+  };
+
+  struct Counter {
+    std::string name;
+    std::vector<int> fds;
+    std::vector<ReadFormat> baselines; // one per fd, taken by start()
+    double scale{1}; // e.g. bytes per count for the IMC counters
+  };
+
+  bool system_wide{false};
+  std::vector<Counter> counters;
+
+  static int open_event(perf_event_attr &attr, pid_t pid, int cpu) {
+    return syscall(__NR_perf_event_open, &attr, pid, cpu, -1, 0);
+  }
+
+  static perf_event_attr make_attr(uint32_t type, uint64_t config, bool system_wide) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    if (!system_wide) {
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+    }
+    return attr;
+  }
+
+  static uint64_t cache_event(uint64_t cache,
+                              uint64_t op = PERF_COUNT_HW_CACHE_OP_READ,
+                              uint64_t result = PERF_COUNT_HW_CACHE_RESULT_MISS) {
+    return cache | (op << 8) | (result << 16);
+  }
+
+  static std::vector<int> configured_cpus() {
+    std::vector<int> cpus;
+    const long nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu = 0; cpu < nr_cpus; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+  static std::vector<pid_t> threads() {
+    std::vector<pid_t> tids;
+    for (const auto &entry : std::filesystem::directory_iterator("/proc/self/task")) {
+      tids.push_back(std::stoi(entry.path().filename().string()));
+    }
+    return tids;
+  }
+
+  static bool probe_system_wide() {
+    auto attr = make_attr(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true);
+    const int fd = open_event(attr, -1, 0);
+    if (fd < 0) {
+      return false;
+    }
+    close(fd);
+    return true;
+  }
+
+  // One counter per thread may exceed the default limit of open files
+  static void raise_fd_limit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+    }
+  }
+
+  void add_core(const char *name, uint32_t type, uint64_t config) {
+    Counter counter;
+    counter.name = name;
+    auto attr = make_attr(type, config, system_wide);
+
+    if (system_wide) {
+      for (int cpu : configured_cpus()) {
+        const int fd = open_event(attr, -1, cpu);
+        if (fd >= 0) {
+          counter.fds.push_back(fd);
+        }
+      }
+    } else {
+      for (pid_t tid : threads()) {
+        const int fd = open_event(attr, tid, -1);
+        if (fd >= 0) {
+          counter.fds.push_back(fd);
+        }
+      }
+    }
+
+    add(std::move(counter));
+  }
+
+  // Opens `event` on every uncore_imc PMU, on one CPU per socket as listed in
+  // its cpumask. The encoding is taken from sysfs, e.g.
+  //   events/cas_count_read = "event=0x04,umask=0x03"
+  //   format/umask          = "config:8-15"
+  void add_uncore(const char *name, const char *event) {
+    namespace fs = std::filesystem;
+    const fs::path root("/sys/bus/event_source/devices");
+
+    Counter counter;
+    counter.name = name;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(root, ec)) {
+      const auto pmu = entry.path();
+      if (pmu.filename().string().rfind("uncore_imc", 0) != 0 ||
+          !fs::exists(pmu / "events" / event)) {
+        continue;
+      }
+
+      uint64_t config = 0;
+      std::string term;
+      std::istringstream terms(read_file(pmu / "events" / event));
+      while (std::getline(terms, term, ',')) {
+        const auto eq = term.find('=');
+        const auto format = read_file(pmu / "format" / term.substr(0, eq)); // "config:lo-hi"
+        const auto lo = std::stoul(format.substr(format.find(':') + 1));
+        const auto value = eq == std::string::npos ? 1 : std::stoull(term.substr(eq + 1), nullptr, 0);
+        config |= value << lo;
+      }
+
+      const auto scale_file = pmu / "events" / (std::string(event) + ".scale");
+      const auto unit_file = pmu / "events" / (std::string(event) + ".unit");
+      if (fs::exists(scale_file)) {
+        counter.scale = std::stod(read_file(scale_file));
+        if (fs::exists(unit_file) && read_file(unit_file).rfind("MiB", 0) == 0) {
+          counter.scale *= 1 << 20;
+        }
+      }
+
+      auto attr = make_attr(std::stoul(read_file(pmu / "type")), config, true);
+      for (int cpu : parse_cpu_list(read_file(pmu / "cpumask"))) {
+        const int fd = open_event(attr, -1, cpu);
+        if (fd >= 0) {
+          counter.fds.push_back(fd);
+        }
+      }
+    }
+
+    add(std::move(counter));
+  }
+
+  void add(Counter counter) {
+    if (!counter.fds.empty()) {
+      counter.baselines.resize(counter.fds.size(), ReadFormat{0, 0, 0});
+      counters.push_back(std::move(counter));
+    }
+  }
+
+  static std::string read_file(const std::filesystem::path &path) {
+    std::ifstream in(path);
+    std::string content;
+    std::getline(in, content);
+    return content;
+  }
+
+  // Parses lists such as "0,20" or "0-3,8"
+  static std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+    std::string range;
+    std::istringstream ranges(list);
+    while (std::getline(ranges, range, ',')) {
+      const auto dash = range.find('-');
+      const int first = std::stoi(range.substr(0, dash));
+      const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  void for_each_fd(unsigned long request) {
+    for (auto &counter : counters) {
+      for (int fd : counter.fds) {
+        ioctl(fd, request, 0);
+      }
+    }
+  }
+
+  static ReadFormat read_fd(int fd) {
+    ReadFormat data{0, 0, 0};
+    if (::read(fd, &data, sizeof(data)) != sizeof(data)) {
+      return ReadFormat{0, 0, 0};
+    }
+    return data;
+  }
+
+  // Sums the counter since start() over all CPUs/threads, extrapolating if the
+  // kernel had to multiplex it with other events
+  static double read(const Counter &counter) {
+    double total = 0;
+    for (size_t i = 0; i < counter.fds.size(); ++i) {
+      const auto now = read_fd(counter.fds[i]);
+      const auto &base = counter.baselines[i];
+      const auto running = now.time_running - base.time_running;
+      if (running == 0) {
+        continue;
+      }
+      total += static_cast<double>(now.value - base.value) * (now.time_enabled - base.time_enabled) /
+               running;
+    }
+    return total * counter.scale;
+  }
+};
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <immintrin.h>
+
+extern "C" {
+#include <numa.h>
+}
+
+// SIMD kernels over the uint32_t arrays gathered from the DPUs. Each kernel
+// has an AVX-512 and an AVX2 path, selected at compile time, and a scalar tail.
+
+inline uint64_t simd_sum(const uint32_t *data, size_t n) {
+  size_t i = 0;
+  uint64_t sum = 0;
+
+#if defined(__AVX512F__)
+  __m512i acc0 = _mm512_setzero_si512();
+  __m512i acc1 = _mm512_setzero_si512();
+  for (; i + 16 <= n; i += 16) {
+    const auto *p = reinterpret_cast<const __m256i *>(data + i);
+    acc0 = _mm512_add_epi64(acc0, _mm512_cvtepu32_epi64(_mm256_loadu_si256(p)));
+    acc1 = _mm512_add_epi64(acc1, _mm512_cvtepu32_epi64(_mm256_loadu_si256(p + 1)));
+  }
+  sum = _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+#elif defined(__AVX2__)
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+  for (; i + 8 <= n; i += 8) {
+    const auto *p = reinterpret_cast<const __m128i *>(data + i);
+    acc0 = _mm256_add_epi64(acc0, _mm256_cvtepu32_epi64(_mm_loadu_si128(p)));
+    acc1 = _mm256_add_epi64(acc1, _mm256_cvtepu32_epi64(_mm_loadu_si128(p + 1)));
+  }
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(acc0, acc1));
+  sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+  for (; i < n; ++i) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+inline void simd_minmax(const uint32_t *data, size_t n, uint32_t &min, uint32_t &max) {
+  size_t i = 0;
+
+#if defined(__AVX512F__)
+  __m512i vmin = _mm512_set1_epi32(min);
+  __m512i vmax = _mm512_set1_epi32(max);
+  for (; i + 16 <= n; i += 16) {
+    const auto v = _mm512_loadu_si512(data + i);
+    vmin = _mm512_min_epu32(vmin, v);
+    vmax = _mm512_max_epu32(vmax, v);
+  }
+  min = _mm512_reduce_min_epu32(vmin);
+  max = _mm512_reduce_max_epu32(vmax);
+#elif defined(__AVX2__)
+  __m256i vmin = _mm256_set1_epi32(min);
+  __m256i vmax = _mm256_set1_epi32(max);
+  for (; i + 8 <= n; i += 8) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    vmin = _mm256_min_epu32(vmin, v);
+    vmax = _mm256_max_epu32(vmax, v);
+  }
+  alignas(32) uint32_t lanes_min[8], lanes_max[8];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes_min), vmin);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes_max), vmax);
+  for (int l = 0; l < 8; ++l) {
+    min = std::min(min, lanes_min[l]);
+    max = std::max(max, lanes_max[l]);
+  }
+#endif
+
+  for (; i < n; ++i) {
+    min = std::min(min, data[i]);
+    max = std::max(max, data[i]);
+  }
+}
+
+// acc[i] += hist[i] for all bins
+inline void simd_histogram_merge(uint32_t *acc, const uint32_t *hist, size_t bins) {
+  size_t i = 0;
+
+#if defined(__AVX512F__)
+  for (; i + 16 <= bins; i += 16) {
+    const auto sum = _mm512_add_epi32(_mm512_loadu_si512(acc + i), _mm512_loadu_si512(hist + i));
+    _mm512_storeu_si512(acc + i, sum);
+  }
+#elif defined(__AVX2__)
+  for (; i + 8 <= bins; i += 8) {
+    auto *a = reinterpret_cast<__m256i *>(acc + i);
+    const auto *h = reinterpret_cast<const __m256i *>(hist + i);
+    _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_loadu_si256(h)));
+  }
+#endif
+
+  for (; i < bins; ++i) {
+    acc[i] += hist[i];
+  }
+}
+
+// Keeps the k largest values in `heap`, a min-heap. Once the heap is full, a
+// vector compare against its minimum skips all blocks without a candidate.
+inline void simd_topk(std::vector<uint32_t> &heap, size_t k, const uint32_t *data, size_t n) {
+  auto push = [&](uint32_t x) {
+    if (heap.size() < k) {
+      heap.push_back(x);
+      std::push_heap(heap.begin(), heap.end(), std::greater<>());
+    } else if (x > heap.front()) {
+      std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+      heap.back() = x;
+      std::push_heap(heap.begin(), heap.end(), std::greater<>());
+    }
+  };
+
+  size_t i = 0;
+  for (; i < n && heap.size() < k; ++i) {
+    push(data[i]);
+  }
+
+#if defined(__AVX512F__)
+  for (; i + 16 <= n; i += 16) {
+    auto mask = _mm512_cmpgt_epu32_mask(_mm512_loadu_si512(data + i), _mm512_set1_epi32(heap.front()));
+    for (; mask; mask &= mask - 1) {
+      push(data[i + __builtin_ctz(mask)]);
+    }
+  }
+#elif defined(__AVX2__)
+  for (; i + 8 <= n; i += 8) {
+    // AVX2 lacks unsigned compares; flip the sign bit to compare as signed
+    const auto sign = _mm256_set1_epi32(0x80000000);
+    const auto v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), sign);
+    const auto t = _mm256_xor_si256(_mm256_set1_epi32(heap.front()), sign);
+    auto mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, t))));
+    for (; mask; mask &= mask - 1) {
+      push(data[i + __builtin_ctz(mask)]);
+    }
+  }
+#endif
+
+  for (; i < n; ++i) {
+    push(data[i]);
+  }
+}
+
+enum class ReduceOp { Sum, MinMax, Histogram, TopK };
+inline const char *reduce_op_to_string(ReduceOp op) {
+  if (op == ReduceOp::Sum) {
+    return "Sum";
+  }
+
+  if (op == ReduceOp::MinMax) {
+    return "MinMax";
+  }
+
+  if (op == ReduceOp::Histogram) {
+    return "Histogram";
+  }
+
+  if (op == ReduceOp::TopK) {
+    return "TopK";
+  }
+
+  abort();
+}
+
+struct ReduceResult {
+  uint64_t sum{0};
+  uint32_t min{std::numeric_limits<uint32_t>::max()};
+  uint32_t max{0};
+  std::vector<uint32_t> histogram;
+  std::vector<uint32_t> topk; // min-heap
+
+  // A single number summarizing the result, so that it can be reported
+  uint64_t digest(ReduceOp op) const {
+    switch (op) {
+    case ReduceOp::Sum:
+      return sum;
+    case ReduceOp::MinMax:
+      return max - min;
+    case ReduceOp::Histogram:
+      return simd_sum(histogram.data(), histogram.size());
+    case ReduceOp::TopK:
+      return topk.empty() ? 0 : topk.front();
+    }
+    abort();
+  }
+};
+
+// Reduces the per-DPU arrays of a gather with worker threads pinned to the
+// NUMA nodes. Work is submitted per DPU to the node holding its host buffer,
+// so a rank's output can be reduced as soon as its transfer is done while
+// other ranks are still being gathered.
+//
+// # Example
+// engine.start(ReduceOp::Sum, nr_elem_per_dpu);
+// for each rank, once gathered: engine.submit(numa_node, first, nr_dpus);
+// const auto& result = engine.finish();
+class ReductionEngine {
+public:
+  ReductionEngine(size_t threads_per_node, size_t topk = 16) : k(topk) {
+    if (threads_per_node == 0) {
+      std::cerr << "Reduction needs at least one thread per NUMA node\n";
+      abort();
+    }
+
+    const int nr_numa_nodes = numa_num_configured_nodes();
+    queues = std::vector<Queue>(nr_numa_nodes);
+
+    partials.resize(nr_numa_nodes * threads_per_node);
+
+    size_t worker = 0;
+    for (int node = 0; node < nr_numa_nodes; ++node) {
+      for (size_t t = 0; t < threads_per_node; ++t, ++worker) {
+        workers.emplace_back([this, node, worker] { run(node, partials[worker]); });
+      }
+    }
+  }
+
+  ReductionEngine(const ReductionEngine &) = delete;
+  ReductionEngine &operator=(const ReductionEngine &) = delete;
+
+  ~ReductionEngine() {
+    for (auto &queue : queues) {
+      std::lock_guard lock(queue.mutex);
+      queue.shutdown = true;
+      queue.cv.notify_all();
+    }
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // The partials are reset lazily by their workers, so that their pages are
+  // first touched on the worker's NUMA node
+  void start(ReduceOp op, size_t nr_elem_per_dpu) {
+    this->op = op;
+    this->nr_elem_per_dpu = nr_elem_per_dpu;
+    generation++;
+  }
+
+  // Queues `nr_dpus` consecutive per-DPU arrays starting at `first`; may be
+  // called from libdpu's callback threads
+  void submit(int numa_node, const uint32_t *first, size_t nr_dpus) {
+    auto &queue = queues[numa_node];
+    pending += nr_dpus;
+
+    std::lock_guard lock(queue.mutex);
+    for (size_t i = 0; i < nr_dpus; ++i) {
+      queue.tasks.push_back(first + i * nr_elem_per_dpu);
+    }
+    queue.cv.notify_all();
+  }
+
+  size_t topk() const { return k; }
+
+  // Waits for all submitted work and merges the per-thread partial results
+  const ReduceResult &finish() {
+    {
+      std::unique_lock lock(done_mutex);
+      done_cv.wait(lock, [&] { return pending == 0; });
+    }
+
+    result = ReduceResult{};
+    if (op == ReduceOp::Histogram) {
+      result.histogram.assign(nr_elem_per_dpu, 0);
+    }
+
+    for (const auto &[partial, partial_generation] : partials) {
+      if (partial_generation != generation) {
+        continue; // worker got no task since start()
+      }
+
+      result.sum += partial.sum;
+      result.min = std::min(result.min, partial.min);
+      result.max = std::max(result.max, partial.max);
+      if (op == ReduceOp::Histogram) {
+        simd_histogram_merge(result.histogram.data(), partial.histogram.data(), nr_elem_per_dpu);
+      }
+      if (op == ReduceOp::TopK) {
+        simd_topk(result.topk, k, partial.topk.data(), partial.topk.size());
+      }
+    }
+
+    return result;
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<const uint32_t *> tasks;
+    bool shutdown{false};
+  };
+
+  size_t k;
+  ReduceOp op{ReduceOp::Sum};
+  size_t nr_elem_per_dpu{0};
+
+  std::vector<Queue> queues;
+  // Each worker owns one partial; `generation` tells whether it was reset
+  // since the last start()
+  struct Partial {
+    ReduceResult result;
+    size_t generation{0};
+  };
+
+  std::vector<Partial> partials;
+  size_t generation{0};
+  std::vector<std::thread> workers;
+
+  std::atomic<size_t> pending{0};
+  std::mutex done_mutex;
+  std::condition_variable done_cv;
+
+  ReduceResult result;
+
+  void run(int node, Partial &slot) {
+    numa_run_on_node(node);
+    auto &queue = queues[node];
+
+    while (true) {
+      const uint32_t *task;
+      {
+        std::unique_lock lock(queue.mutex);
+        queue.cv.wait(lock, [&] { return queue.shutdown || !queue.tasks.empty(); });
+        if (queue.tasks.empty()) {
+          return;
+        }
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+
+      auto &partial = slot.result;
+      if (slot.generation != generation) {
+        partial.sum = 0;
+        partial.min = std::numeric_limits<uint32_t>::max();
+        partial.max = 0;
+        partial.topk.clear();
+        if (op == ReduceOp::Histogram) {
+          // keeps the capacity, so pages stay where this worker touched them
+          partial.histogram.assign(nr_elem_per_dpu, 0);
+        }
+        slot.generation = generation;
+      }
+
+      reduce(partial, task);
+
+      if (--pending == 0) {
+        std::lock_guard lock(done_mutex);
+        done_cv.notify_all();
+      }
+    }
+  }
+
+  void reduce(ReduceResult &partial, const uint32_t *data) const {
+    switch (op) {
+    case ReduceOp::Sum:
+      partial.sum += simd_sum(data, nr_elem_per_dpu);
+      break;
+    case ReduceOp::MinMax:
+      simd_minmax(data, nr_elem_per_dpu, partial.min, partial.max);
+      break;
+    case ReduceOp::Histogram:
+      simd_histogram_merge(partial.histogram.data(), data, nr_elem_per_dpu);
+      break;
+    case ReduceOp::TopK:
+      simd_topk(partial.topk, k, data, nr_elem_per_dpu);
+      break;
+    }
+  }
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <dpu.h>
+#include <numa.h>
+}
+
+enum class SchedulePolicy { Unscheduled, Fifo, NumaAffine, BandwidthFair };
+inline const char *schedule_policy_to_string(SchedulePolicy policy) {
+  if (policy == SchedulePolicy::Unscheduled) {
+    return "Unscheduled";
+  }
+
+  if (policy == SchedulePolicy::Fifo) {
+    return "Fifo";
+  }
+
+  if (policy == SchedulePolicy::NumaAffine) {
+    return "NumaAffine";
+  }
+
+  if (policy == SchedulePolicy::BandwidthFair) {
+    return "BandwidthFair";
+  }
+
+  abort();
+}
+
+// Transfer between one rank and a host buffer holding one slot of
+// `bytes_per_dpu` per DPU
+struct RankTransfer {
+  dpu_set_t rank;
+  int numa_node;
+  dpu_xfer_t direction;
+  uint8_t *host;
+  size_t bytes_per_dpu;
+};
+
+// Dispatches the rank transfers of several jobs onto a fixed set of worker
+// threads, `workers_per_node` of them pinned to each NUMA node. A worker only
+// issues an asynchronous push; a libdpu callback completes the request once
+// the rank is done, so all ranks can transfer at once. The policy decides
+// which pending transfer an idle worker dispatches next:
+//  - Unscheduled: none, execute() pushes the job's ranks itself (baseline)
+//  - Fifo: the oldest one
+//  - NumaAffine: the oldest one whose rank sits on the worker's node, or
+//    whose node is unknown (outside [0, numa_num_configured_nodes()))
+//  - BandwidthFair: the oldest one of the job that was served the fewest bytes
+//
+// A rank must only be used by one job, and a job must have at most one request
+// in flight, since libdpu does not allow concurrent transfers on one rank.
+class TransferScheduler {
+public:
+  TransferScheduler(SchedulePolicy policy, size_t nr_jobs, size_t workers_per_node)
+      : policy(policy), nr_numa_nodes(numa_num_configured_nodes()), served_bytes(nr_jobs, 0) {
+    if (policy == SchedulePolicy::Unscheduled) {
+      return;
+    }
+
+    for (int node = 0; node < nr_numa_nodes; ++node) {
+      for (size_t t = 0; t < workers_per_node; ++t) {
+        workers.emplace_back([this, node] { run(node); });
+      }
+    }
+  }
+
+  TransferScheduler(const TransferScheduler &) = delete;
+  TransferScheduler &operator=(const TransferScheduler &) = delete;
+
+  ~TransferScheduler() {
+    {
+      std::lock_guard lock(mutex);
+      shutdown = true;
+    }
+    work_cv.notify_all();
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Queues all transfers of a request and blocks until they completed
+  void execute(size_t job, const std::vector<RankTransfer> &transfers) {
+    if (policy == SchedulePolicy::Unscheduled) {
+      for (const auto &transfer : transfers) {
+        push(transfer);
+      }
+      for (const auto &transfer : transfers) {
+        DPU_ASSERT(dpu_sync(transfer.rank));
+      }
+      return;
+    }
+
+    Request request{this, transfers.size()};
+
+    {
+      std::lock_guard lock(mutex);
+      for (const auto &transfer : transfers) {
+        pending.push_back({transfer, job, &request});
+      }
+    }
+    work_cv.notify_all();
+
+    std::unique_lock lock(mutex);
+    done_cv.wait(lock, [&] { return request.remaining == 0; });
+  }
+
+private:
+  struct Request {
+    TransferScheduler *scheduler;
+    size_t remaining;
+  };
+
+  struct Op {
+    RankTransfer transfer;
+    size_t job;
+    Request *request;
+  };
+
+  SchedulePolicy policy;
+  int nr_numa_nodes;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+  std::deque<Op> pending; // in arrival order
+  std::vector<uint64_t> served_bytes;
+  bool shutdown{false};
+
+  // Returns the position of the op the worker on `node` should run next, or
+  // pending.size() if there is none; requires the lock
+  size_t select(int node) const {
+    switch (policy) {
+    case SchedulePolicy::Unscheduled:
+      return pending.size();
+
+    case SchedulePolicy::Fifo:
+      return 0;
+
+    case SchedulePolicy::NumaAffine:
+      for (size_t i = 0; i < pending.size(); ++i) {
+        const int op_node = pending[i].transfer.numa_node;
+        if (op_node == node || op_node < 0 || op_node >= nr_numa_nodes) {
+          return i;
+        }
+      }
+      return pending.size();
+
+    case SchedulePolicy::BandwidthFair: {
+      size_t best = pending.size();
+      uint64_t best_served = std::numeric_limits<uint64_t>::max();
+      for (size_t i = 0; i < pending.size(); ++i) {
+        if (served_bytes[pending[i].job] < best_served) {
+          best = i;
+          best_served = served_bytes[pending[i].job];
+        }
+      }
+      return best;
+    }
+    }
+
+    abort();
+  }
+
+  void run(int node) {
+    numa_run_on_node(node);
+
+    while (true) {
+      Op op;
+      {
+        std::unique_lock lock(mutex);
+        size_t idx;
+        work_cv.wait(lock, [&] {
+          idx = select(node);
+          return shutdown || idx < pending.size();
+        });
+
+        if (shutdown) {
+          return;
+        }
+
+        op = pending[idx];
+        pending.erase(pending.begin() + idx);
+        served_bytes[op.job] += transfer_bytes(op.transfer);
+      }
+
+      push(op.transfer);
+      DPU_ASSERT(dpu_callback(op.transfer.rank, complete, op.request, DPU_CALLBACK_ASYNC));
+    }
+  }
+
+  // Runs on a libdpu thread once a rank finished its transfer
+  static dpu_error_t complete(dpu_set_t, uint32_t, void *arg) {
+    auto *request = static_cast<Request *>(arg);
+    auto *scheduler = request->scheduler;
+    {
+      std::lock_guard lock(scheduler->mutex);
+      request->remaining--;
+    }
+    scheduler->done_cv.notify_all();
+    return DPU_OK;
+  }
+
+  static size_t transfer_bytes(const RankTransfer &t) {
+    uint32_t nr_dpus;
+    DPU_ASSERT(dpu_get_nr_dpus(t.rank, &nr_dpus));
+    return nr_dpus * t.bytes_per_dpu;
+  }
+
+  static void push(const RankTransfer &t) {
+    dpu_set_t dpu;
+    uint32_t dpu_id;
+    DPU_FOREACH(t.rank, dpu, dpu_id) {
+      DPU_ASSERT(dpu_prepare_xfer(dpu, t.host + dpu_id * t.bytes_per_dpu));
+    }
+    DPU_ASSERT(dpu_push_xfer(t.rank, t.direction, "dpu_mram_buffer", 0,
+                             t.bytes_per_dpu, DPU_XFER_ASYNC));
+  }
+};
@@ -0,0 +1,87 @@
+// Measures the time from process start to the first transfer: allocating
+// ranks, loading the DPU binary (sequentially and in parallel), the first
+// transfer and freeing the ranks, for increasing numbers of ranks.
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "startup.hpp"
+#include "timer.hpp"
+
+extern "C" {
+#include <dpu.h>
+}
+
+const size_t max_nr_ranks = 32;
+const char *binary = "./checksum_dpu";
+
+void benchmark(size_t nr_ranks, bool parallel_load, const char *profile) {
+  StartupTimes times;
+  auto set = alloc_and_load(nr_ranks, profile, binary, parallel_load, times);
+
+  uint32_t nr_dpus;
+  DPU_ASSERT(dpu_get_nr_dpus(set, &nr_dpus));
+
+  double first_xfer_seconds;
+  {
+    Timer timer("FirstTransfer");
+    timer.hide();
+    const uint64_t word = 0;
+    DPU_ASSERT(dpu_broadcast_to(set, "dpu_mram_buffer", 0, &word, sizeof(word),
+                                DPU_XFER_DEFAULT));
+    first_xfer_seconds = timer.seconds_since_start();
+  }
+
+  double free_seconds;
+  {
+    Timer timer("Free");
+    timer.hide();
+    DPU_ASSERT(dpu_free(set));
+    free_seconds = timer.seconds_since_start();
+  }
+
+  std::cerr << "{" //
+               "\"mode\": \"Startup\", " //
+               "\"ranks\": "
+            << nr_ranks
+            << ", " //
+               "\"dpus\": "
+            << nr_dpus
+            << ", " //
+               "\"parallel_load\": "
+            << parallel_load
+            << ", " //
+               "\"alloc_seconds\": "
+            << times.alloc_seconds
+            << ", " //
+               "\"load_seconds\": "
+            << times.load_seconds
+            << ", " //
+               "\"first_xfer_seconds\": "
+            << first_xfer_seconds
+            << ", " //
+               "\"free_seconds\": "
+            << free_seconds
+            << ", " //
+               "\"seconds\": "
+            << (times.alloc_seconds + times.load_seconds + first_xfer_seconds)
+            << ", " //
+               "\"profile\": \""
+            << profile << "\"}\n";
+}
+
+int main() {
+  for (int i = 0; i < 3; ++i) {
+    for (size_t nr_ranks = 1; nr_ranks <= max_nr_ranks; nr_ranks *= 2) {
+      for (int nrThreadPerPool = 1; nrThreadPerPool <= 8; nrThreadPerPool *= 2) {
+        const auto profile = "nrThreadPerPool=" + std::to_string(nrThreadPerPool);
+        for (int parallel_load = 0; parallel_load <= 1; ++parallel_load) {
+          benchmark(nr_ranks, parallel_load, profile.c_str());
+        }
+      }
+    }
+  }
+
+  std::cerr << "\n";
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+#include "timer.hpp"
+
+extern "C" {
+#include <dpu.h>
+}
+
+struct StartupTimes {
+  double alloc_seconds{0};
+  double load_seconds{0};
+  bool reused{false};
+};
+
+// Loads the binary onto every rank of the set. With `parallel`, each rank is
+// loaded from its own thread instead of libdpu walking the ranks in turn.
+inline void load_ranks(dpu_set_t set, const char *binary, bool parallel) {
+  if (!parallel) {
+    DPU_ASSERT(dpu_load(set, binary, NULL));
+    return;
+  }
+
+  std::vector<dpu_set_t> ranks;
+  dpu_set_t rank;
+  DPU_RANK_FOREACH(set, rank) { ranks.push_back(rank); }
+
+#pragma omp parallel for schedule(static, 1) num_threads(ranks.size())
+  for (size_t i = 0; i < ranks.size(); ++i) {
+    DPU_ASSERT(dpu_load(ranks[i], binary, NULL));
+  }
+}
+
+inline dpu_set_t alloc_and_load(size_t nr_ranks, const char *profile,
+                                const char *binary, bool parallel,
+                                StartupTimes &times) {
+  struct dpu_set_t set;
+
+  {
+    Timer timer("Alloc");
+    timer.hide();
+    DPU_ASSERT(dpu_alloc_ranks(nr_ranks, profile, &set));
+    times.alloc_seconds = timer.seconds_since_start();
+  }
+
+  if (set.list.nr_ranks != nr_ranks) {
+    std::cout << "Expected " << nr_ranks << " ranks, got " << set.list.nr_ranks
+              << "\n";
+    abort();
+  }
+
+  {
+    Timer timer("Load");
+    timer.hide();
+    load_ranks(set, binary, parallel);
+    times.load_seconds = timer.seconds_since_start();
+  }
+
+  times.reused = false;
+  return set;
+}
+
+// Keeps the most recently allocated and loaded set alive, so that sweeps
+// using the same profile skip the startup cost. The binary is reloaded only
+// if it changed on disk since it was loaded.
+class DpuSetCache {
+public:
+  DpuSetCache(const char *binary, size_t nr_ranks, bool parallel_load)
+      : binary(binary), nr_ranks(nr_ranks), parallel_load(parallel_load) {}
+
+  DpuSetCache(const DpuSetCache &) = delete;
+  DpuSetCache &operator=(const DpuSetCache &) = delete;
+
+  ~DpuSetCache() { release(); }
+
+  dpu_set_t acquire(const std::string &profile) {
+    if (set && cached_profile == profile) {
+      times = StartupTimes{};
+      times.reused = true;
+
+      const auto stamp = binary_stamp();
+      if (stamp != loaded_stamp) {
+        std::cout << "Binary " << binary << " changed, reloading\n";
+        Timer timer("Load");
+        timer.hide();
+        load_ranks(*set, binary, parallel_load);
+        times.load_seconds = timer.seconds_since_start();
+        loaded_stamp = stamp;
+      }
+
+      return *set;
+    }
+
+    release();
+    loaded_stamp = binary_stamp();
+    set = alloc_and_load(nr_ranks, profile.c_str(), binary, parallel_load, times);
+    cached_profile = profile;
+    return *set;
+  }
+
+  void release() {
+    if (set) {
+      DPU_ASSERT(dpu_free(*set));
+      set.reset();
+    }
+  }
+
+  const StartupTimes &last_startup() const { return times; }
+
+private:
+  using Stamp = std::pair<long long, long long>; // mtime in ns, file size
+
+  const char *binary;
+  size_t nr_ranks;
+  bool parallel_load;
+
+  std::optional<dpu_set_t> set;
+  std::string cached_profile;
+  Stamp loaded_stamp;
+  StartupTimes times;
+
+  Stamp binary_stamp() const {
+    struct stat st;
+    if (stat(binary, &st) != 0) {
+      std::cerr << "Cannot stat DPU binary " << binary << "\n";
+      abort();
+    }
+    return {st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec, st.st_size};
+  }
+};
@@ -0,0 +1,238 @@
+// Several independent jobs share the rank pool: each job owns a subset of the
+// ranks and issues a stream of Scatter/Gather requests on them. Compares how
+// partitioning the ranks and scheduling the transfers affects per-job
+// throughput, tail latency and aggregate bandwidth.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scheduler.hpp"
+#include "startup.hpp"
+#include "timer.hpp"
+
+extern "C" {
+#include <dpu.h>
+#ifdef USE_DPU_NUMA
+#include <dpu_rank.h>
+#endif
+#include <numa.h>
+}
+
+const size_t nr_ranks = 32;
+const size_t nr_dpus_per_rank = 64;
+const char *binary = "./checksum_dpu";
+const size_t nr_requests_per_job = 64;
+const size_t workers_per_node = 2;
+const double gather_ratio = 0.5;
+
+// Job j draws its request sizes from size class j % 3, so that light and
+// heavy tenants compete
+const size_t size_classes[][2] = {{64 << 10, 256 << 10}, {256 << 10, 1 << 20}, {1 << 20, 4 << 20}};
+const size_t max_bytes_per_dpu = 4 << 20;
+
+struct Rank {
+  dpu_set_t set;
+  int numa_node;
+  uint8_t *host;
+};
+
+// Packed: a job's ranks share as few NUMA nodes as possible
+// Spread: a job's ranks are spread over all NUMA nodes
+enum class Partition { Packed, Spread };
+const char *partition_to_string(Partition partition) {
+  if (partition == Partition::Packed) {
+    return "Packed";
+  }
+
+  if (partition == Partition::Spread) {
+    return "Spread";
+  }
+
+  abort();
+}
+
+std::vector<std::vector<const Rank *>> partition_ranks(const std::vector<Rank> &ranks,
+                                                       size_t nr_jobs, Partition partition) {
+  std::vector<const Rank *> by_node;
+  for (const auto &rank : ranks) {
+    by_node.push_back(&rank);
+  }
+  std::stable_sort(by_node.begin(), by_node.end(),
+                   [](const Rank *a, const Rank *b) { return a->numa_node < b->numa_node; });
+
+  std::vector<std::vector<const Rank *>> jobs(nr_jobs);
+  for (size_t i = 0; i < by_node.size(); ++i) {
+    const auto job = partition == Partition::Packed ? i * nr_jobs / by_node.size() : i % nr_jobs;
+    jobs[job].push_back(by_node[i]);
+  }
+  return jobs;
+}
+
+struct JobStats {
+  size_t nr_ranks{0};
+  uint64_t bytes{0};
+  double seconds{0};
+  LatencySamples latencies;
+};
+
+void run_job(TransferScheduler &scheduler, size_t job, const std::vector<const Rank *> &ranks,
+             JobStats &stats) {
+  std::mt19937_64 gen(job + 1);
+  const auto &size_class = size_classes[job % std::size(size_classes)];
+  std::uniform_int_distribution<size_t> size_dist(size_class[0] / 8, size_class[1] / 8);
+  std::bernoulli_distribution is_gather(gather_ratio);
+
+  stats.nr_ranks = ranks.size();
+  Timer timer("Job");
+  timer.hide();
+
+  for (size_t i = 0; i < nr_requests_per_job; ++i) {
+    // MRAM transfers must be multiples of 8 bytes
+    const size_t bytes_per_dpu = 8 * size_dist(gen);
+    const auto direction = is_gather(gen) ? DPU_XFER_FROM_DPU : DPU_XFER_TO_DPU;
+
+    std::vector<RankTransfer> transfers;
+    for (const auto *rank : ranks) {
+      transfers.push_back({rank->set, rank->numa_node, direction, rank->host, bytes_per_dpu});
+    }
+
+    Timer request("Request");
+    request.hide();
+    scheduler.execute(job, transfers);
+    stats.latencies.add(request.seconds_since_start());
+    stats.bytes += bytes_per_dpu * nr_dpus_per_rank * ranks.size();
+  }
+
+  stats.seconds = timer.seconds_since_start();
+}
+
+void benchmark(const std::vector<Rank> &ranks, size_t nr_jobs, Partition partition,
+               SchedulePolicy policy, const char *profile) {
+  const auto job_ranks = partition_ranks(ranks, nr_jobs, partition);
+  std::vector<JobStats> stats(nr_jobs);
+
+  double seconds;
+  {
+    TransferScheduler scheduler(policy, nr_jobs, workers_per_node);
+    Timer timer("Tenants");
+    timer.hide();
+
+    std::vector<std::thread> jobs;
+    for (size_t job = 0; job < nr_jobs; ++job) {
+      jobs.emplace_back([&, job] { run_job(scheduler, job, job_ranks[job], stats[job]); });
+    }
+    for (auto &job : jobs) {
+      job.join();
+    }
+
+    seconds = timer.seconds_since_start();
+  }
+
+  auto print = [&](long job, const JobStats &s) {
+    std::cerr << "{" //
+                 "\"mode\": \"Tenants\", " //
+                 "\"policy\": \""
+              << schedule_policy_to_string(policy)
+              << "\", " //
+                 "\"partition\": \""
+              << partition_to_string(partition)
+              << "\", " //
+                 "\"jobs\": "
+              << nr_jobs
+              << ", " //
+                 "\"job\": "
+              << job
+              << ", " //
+                 "\"ranks\": "
+              << s.nr_ranks
+              << ", " //
+                 "\"bytes\": "
+              << s.bytes
+              << ", " //
+                 "\"seconds\": "
+              << s.seconds
+              << ", " //
+                 "\"gbs\": "
+              << (double)s.bytes / (1 << 30) / s.seconds << ", ";
+    s.latencies.print_json_fields(std::cerr, "latency_");
+    std::cerr << ", " //
+                 "\"profile\": \""
+              << profile << "\"}\n";
+  };
+
+  JobStats total;
+  for (size_t job = 0; job < nr_jobs; ++job) {
+    print(job, stats[job]);
+    total.nr_ranks += stats[job].nr_ranks;
+    total.bytes += stats[job].bytes;
+    for (auto x : stats[job].latencies.samples) {
+      total.latencies.add(x);
+    }
+  }
+
+  // job = -1 summarizes all jobs; its bandwidth is the aggregate one
+  total.seconds = seconds;
+  print(-1, total);
+}
+
+int main() {
+  if (numa_available() == -1) {
+    std::cerr << "No NUMA support\n";
+    abort();
+  }
+
+  for (int nrThreadPerPool = 1; nrThreadPerPool <= 8; nrThreadPerPool *= 2) {
+    const auto profile = "nrThreadPerPool=" + std::to_string(nrThreadPerPool);
+    std::cout << "Profile: " << profile << "\n";
+
+    StartupTimes times;
+    auto set = alloc_and_load(nr_ranks, profile.c_str(), binary, true, times);
+
+    std::vector<Rank> ranks;
+    {
+      dpu_set_t rank;
+      uint32_t rank_id;
+      DPU_RANK_FOREACH(set, rank, rank_id) {
+#ifdef USE_DPU_NUMA
+        const int numa_node = rank.list.ranks[0]->numa_node;
+#else
+        const int numa_node = rank_id % numa_num_configured_nodes();
+#endif
+        const auto bytes = nr_dpus_per_rank * max_bytes_per_dpu;
+        // the driver may not know the node of a rank (-1)
+        const bool known_node = numa_node >= 0 && numa_node < numa_num_configured_nodes();
+        auto *host = static_cast<uint8_t *>(known_node ? numa_alloc_onnode(bytes, numa_node)
+                                                       : numa_alloc_local(bytes));
+        if (host == nullptr) {
+          std::cerr << "Failed to allocate buffer on node " << numa_node << "\n";
+          abort();
+        }
+        std::fill(host, host + bytes, static_cast<uint8_t>(rank_id));
+        ranks.push_back({rank, numa_node, host});
+      }
+    }
+
+    for (size_t nr_jobs = 2; nr_jobs <= 8; nr_jobs *= 2) {
+      for (auto partition : {Partition::Packed, Partition::Spread}) {
+        for (auto policy : {SchedulePolicy::Unscheduled, SchedulePolicy::Fifo,
+                            SchedulePolicy::NumaAffine, SchedulePolicy::BandwidthFair}) {
+          benchmark(ranks, nr_jobs, partition, policy, profile.c_str());
+        }
+      }
+    }
+
+    for (auto &rank : ranks) {
+      numa_free(rank.host, nr_dpus_per_rank * max_bytes_per_dpu);
+    }
+    DPU_ASSERT(dpu_free(set));
+  }
+
+  std::cerr << "\n";
+}
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
 #include <iostream>
+#include <numeric>
 #include <string>
+#include <vector>
 
 struct Timer {
   std::chrono::time_point<std::chrono::steady_clock> start;
@@ -87,4 +90,41 @@ struct BandwidthTimer {
     std::cout << "Bandwidth[" << timer.name << "]: " << bandwidth << prefix
               << "B/s\n";
   }
-};
\ No newline at end of file
+};
+
+// Collects individual latencies (in seconds) and prints their distribution as
+// JSON fields in microseconds.
+struct LatencySamples {
+  std::vector<double> samples;
+
+  void add(double seconds) { samples.push_back(seconds); }
+
+  double quantile(double q) const {
+    if (samples.empty()) {
+      return 0;
+    }
+
+    auto sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[static_cast<size_t>(q * (sorted.size() - 1))];
+  }
+
+  double mean() const {
+    if (samples.empty()) {
+      return 0;
+    }
+
+    return std::accumulate(samples.begin(), samples.end(), 0.0) /
+           samples.size();
+  }
+
+  void print_json_fields(std::ostream &os, const std::string &prefix = "") const {
+    os << "\"" << prefix << "samples\": " << samples.size()         //
+       << ", \"" << prefix << "mean_us\": " << mean() * 1e6         //
+       << ", \"" << prefix << "min_us\": " << quantile(0) * 1e6     //
+       << ", \"" << prefix << "p50_us\": " << quantile(0.5) * 1e6   //
+       << ", \"" << prefix << "p90_us\": " << quantile(0.9) * 1e6   //
+       << ", \"" << prefix << "p99_us\": " << quantile(0.99) * 1e6  //
+       << ", \"" << prefix << "max_us\": " << quantile(1) * 1e6;
+  }
+};
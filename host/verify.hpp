@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "timer.hpp"
+
+extern "C" {
+#include <dpu.h>
+#include "../common/checksum_common.h"
+}
+
+struct VerifyResult {
+  size_t checked_dpus{0};
+  size_t mismatches{0};
+  double seconds{0};
+};
+
+// Spot-checks the data moved by a timed transfer on every `dpu_stride`-th DPU
+// and every `size_stride`-th transfer size.
+//  - Scatter/Broadcast: launch the checksum kernel and compare against a
+//    host reference, which is cached per (source, size).
+//  - Gather: seed the sampled DPUs with a known MRAM pattern before the
+//    transfer and compare what arrived on the host.
+//  - Reduce: recompute the digest of the reduction with plain scalar loops.
+// All of this happens outside the timed region; its cost is reported
+// separately as `verify_seconds`.
+class Verifier {
+public:
+  using T = uint32_t;
+
+  Verifier(size_t dpu_stride = 0, size_t size_stride = 1)
+      : dpu_stride(dpu_stride), size_stride(size_stride ? size_stride : 1) {}
+
+  bool enabled() const { return dpu_stride > 0; }
+
+  bool covers_size_step(size_t size_step) const {
+    return enabled() && size_step % size_stride == 0;
+  }
+
+  bool is_sampled(size_t dpu_idx) const { return dpu_idx % dpu_stride == 0; }
+
+  // Writes the gather pattern into the MRAM of all sampled DPUs
+  void seed_gather_pattern(dpu_set_t dpu_set, size_t nr_elem_per_dpu) {
+    Timer timer("SeedGather");
+    timer.hide();
+
+    std::vector<T> pattern(nr_elem_per_dpu);
+    dpu_set_t dpu;
+    uint32_t dpu_idx;
+    DPU_FOREACH(dpu_set, dpu, dpu_idx) {
+      if (!is_sampled(dpu_idx)) {
+        continue;
+      }
+
+      for (size_t j = 0; j < nr_elem_per_dpu; ++j) {
+        pattern[j] = gather_pattern(dpu_idx, j);
+      }
+
+      DPU_ASSERT(dpu_copy_to(dpu, XSTR(DPU_BUFFER), 0, pattern.data(),
+                             nr_elem_per_dpu * sizeof(T)));
+    }
+
+    seed_seconds = timer.seconds_since_start();
+  }
+
+  // Compares the host ranges filled by a Gather against the seeded pattern
+  VerifyResult check_gather(const std::vector<const T *> &targets,
+                            size_t nr_elem_per_dpu) {
+    Timer timer("VerifyGather");
+    timer.hide();
+
+    VerifyResult result;
+    for (size_t dpu_idx = 0; dpu_idx < targets.size(); ++dpu_idx) {
+      if (!is_sampled(dpu_idx) || targets[dpu_idx] == nullptr) {
+        continue;
+      }
+
+      const T *first = targets[dpu_idx];
+      size_t nr_wrong = 0;
+#pragma omp parallel for reduction(+ : nr_wrong)
+      for (size_t j = 0; j < nr_elem_per_dpu; ++j) {
+        nr_wrong += first[j] != gather_pattern(dpu_idx, j);
+      }
+
+      result.checked_dpus++;
+      if (nr_wrong) {
+        report_mismatch(dpu_idx, nr_elem_per_dpu, "elements differ", nr_wrong);
+        result.mismatches++;
+      }
+    }
+
+    // the gather overwrote host buffers that may back cached references
+    references.clear();
+
+    result.seconds = timer.seconds_since_start() + seed_seconds;
+    seed_seconds = 0;
+    return result;
+  }
+
+  // Runs the checksum kernel on the sampled DPUs and compares the result
+  // against the checksum of the host buffer they were fed from
+  VerifyResult check_transfer(dpu_set_t dpu_set,
+                              const std::vector<const T *> &sources,
+                              size_t nr_elem_per_dpu) {
+    Timer timer("VerifyTransfer");
+    timer.hide();
+
+    const uint32_t nr_elements = nr_elem_per_dpu;
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, XSTR(DPU_NR_ELEMENTS), 0, &nr_elements,
+                                sizeof(nr_elements), DPU_XFER_DEFAULT));
+
+    // We launch whole ranks which contain at least one sampled DPU; the others
+    // compute a checksum nobody looks at, but do not add to the wall time.
+    {
+      dpu_set_t rank;
+      size_t first_dpu = 0;
+      DPU_RANK_FOREACH(dpu_set, rank) {
+        uint32_t nr_rank_dpus;
+        DPU_ASSERT(dpu_get_nr_dpus(rank, &nr_rank_dpus));
+
+        bool launch = false;
+        for (size_t i = first_dpu; i < first_dpu + nr_rank_dpus; ++i) {
+          launch |= is_sampled(i) && sources[i] != nullptr;
+        }
+
+        if (launch) {
+          DPU_ASSERT(dpu_launch(rank, DPU_ASYNCHRONOUS));
+        }
+
+        first_dpu += nr_rank_dpus;
+      }
+      DPU_ASSERT(dpu_sync(dpu_set));
+    }
+
+    VerifyResult result;
+    dpu_set_t dpu;
+    uint32_t dpu_idx;
+    DPU_FOREACH(dpu_set, dpu, dpu_idx) {
+      if (!is_sampled(dpu_idx) || sources[dpu_idx] == nullptr) {
+        continue;
+      }
+
+      dpu_results_t dpu_results;
+      DPU_ASSERT(dpu_copy_from(dpu, XSTR(DPU_RESULTS), 0, &dpu_results,
+                               sizeof(dpu_results)));
+
+      uint32_t dpu_checksum = checksum_init();
+      for (uint32_t i = 0; i < dpu_results.nr_actual_tasklets; ++i) {
+        dpu_checksum = checksum_combine(dpu_checksum,
+                                        dpu_results.tasklet_result[i].checksum);
+      }
+
+      const auto expected = reference(sources[dpu_idx], nr_elem_per_dpu);
+
+      result.checked_dpus++;
+      if (dpu_checksum != expected) {
+        report_mismatch(dpu_idx, nr_elem_per_dpu, "checksum differs", 1);
+        result.mismatches++;
+      }
+    }
+
+    result.seconds = timer.seconds_since_start();
+    return result;
+  }
+
+  // Recomputes the digest of reducing the per-DPU arrays in `ranges`, each
+  // given as (first, nr_dpus), and compares it to the one of the engine
+  VerifyResult check_reduce(ReduceOp op, size_t topk,
+                            const std::vector<std::pair<const T *, size_t>> &ranges,
+                            size_t nr_elem_per_dpu, uint64_t digest) {
+    Timer timer("VerifyReduce");
+    timer.hide();
+
+    std::vector<const T *> dpus;
+    for (const auto &[first, nr_dpus] : ranges) {
+      for (size_t d = 0; d < nr_dpus; ++d) {
+        dpus.push_back(first + d * nr_elem_per_dpu);
+      }
+    }
+    const auto nr_dpus = dpus.size();
+    const auto n = nr_elem_per_dpu;
+
+    ReduceResult expected;
+    switch (op) {
+    case ReduceOp::Sum: {
+      uint64_t sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+      for (size_t d = 0; d < nr_dpus; ++d) {
+        for (size_t j = 0; j < n; ++j) {
+          sum += dpus[d][j];
+        }
+      }
+      expected.sum = sum;
+      break;
+    }
+
+    case ReduceOp::MinMax: {
+      T min = expected.min, max = expected.max;
+#pragma omp parallel for reduction(min : min) reduction(max : max)
+      for (size_t d = 0; d < nr_dpus; ++d) {
+        for (size_t j = 0; j < n; ++j) {
+          min = std::min(min, dpus[d][j]);
+          max = std::max(max, dpus[d][j]);
+        }
+      }
+      expected.min = min;
+      expected.max = max;
+      break;
+    }
+
+    case ReduceOp::Histogram: {
+      // each thread owns a block of bins and walks it DPU by DPU
+      const size_t block = 4096;
+      expected.histogram.assign(n, 0);
+      auto *histogram = expected.histogram.data();
+#pragma omp parallel for
+      for (size_t begin = 0; begin < n; begin += block) {
+        const auto end = std::min(n, begin + block);
+        for (size_t d = 0; d < nr_dpus; ++d) {
+          for (size_t j = begin; j < end; ++j) {
+            histogram[j] += dpus[d][j];
+          }
+        }
+      }
+      break;
+    }
+
+    case ReduceOp::TopK: {
+      // min-heaps of the k largest values; only values above the current
+      // k-th largest are inserted
+      auto push = [topk](std::vector<T> &heap, T x) {
+        if (heap.size() < topk) {
+          heap.push_back(x);
+          std::push_heap(heap.begin(), heap.end(), std::greater<>());
+        } else if (topk > 0 && x > heap.front()) {
+          std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+          heap.back() = x;
+          std::push_heap(heap.begin(), heap.end(), std::greater<>());
+        }
+      };
+
+#pragma omp parallel
+      {
+        std::vector<T> heap;
+#pragma omp for nowait
+        for (size_t d = 0; d < nr_dpus; ++d) {
+          for (size_t j = 0; j < n; ++j) {
+            push(heap, dpus[d][j]);
+          }
+        }
+#pragma omp critical
+        for (auto x : heap) {
+          push(expected.topk, x);
+        }
+      }
+      break;
+    }
+    }
+
+    VerifyResult result;
+    if (expected.digest(op) != digest) {
+      std::cout << "Verification failed for " << reduce_op_to_string(op)
+                << " with n=" << nr_elem_per_dpu << ": digest " << digest
+                << ", expected " << expected.digest(op) << "\n";
+      result.mismatches++;
+    }
+
+    result.seconds = timer.seconds_since_start();
+    return result;
+  }
+
+private:
+  size_t dpu_stride;
+  size_t size_stride;
+  double seed_seconds{0};
+  std::map<std::pair<const T *, size_t>, uint32_t> references;
+
+  static T gather_pattern(size_t dpu_idx, size_t j) {
+    return hash(static_cast<uint32_t>(dpu_idx * 0x9e3779b9u + j + 1));
+  }
+
+  uint32_t reference(const T *first, size_t n) {
+    auto [it, inserted] = references.try_emplace({first, n}, 0);
+    if (!inserted) {
+      return it->second;
+    }
+
+    // checksum_combine is a plain sum, so OpenMP may reduce partial checksums
+    uint32_t checksum = checksum_init();
+#pragma omp parallel for reduction(+ : checksum)
+    for (size_t i = 0; i < n; ++i) {
+      checksum = checksum_update(checksum, i, first[i]);
+    }
+
+    it->second = checksum;
+    return checksum;
+  }
+
+  static void report_mismatch(size_t dpu_idx, size_t n, const char *what,
+                              size_t count) {
+    std::cout << "Verification failed for DPU " << dpu_idx << " with n=" << n
+              << ": " << what << " (" << count << ")\n";
+  }
+};